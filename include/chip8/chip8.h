@@ -43,6 +43,7 @@ typedef struct Chip8State {
 typedef enum Chip8Res {
     CHIP8_ERROR,
     CHIP8_SUCCESS,
+    CHIP8_BREAK, // Execution stopped by the debugger, see chip8/debugger.h
 } Chip8Res;
 
 extern const uint8_t Chip8DefaultFont[];       // Byte font used for some characters
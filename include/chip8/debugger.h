@@ -0,0 +1,44 @@
+#ifndef CHIP8_DEBUGGER_H_
+#define CHIP8_DEBUGGER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8/chip8.h"
+
+#define CHIP8_DEBUGGER_LINE_SIZE 256
+
+typedef enum Chip8DebugFlag { // Per-address flags, combined in Chip8Debugger.flags
+    CHIP8_DEBUG_BREAK = 1 << 0,
+    CHIP8_DEBUG_WATCH_READ = 1 << 1,
+    CHIP8_DEBUG_WATCH_WRITE = 1 << 2,
+} Chip8DebugFlag;
+
+typedef struct Chip8Debugger {
+    uint8_t flags[MAX_MEM]; // Breakpoint and watchpoint flags for every address
+    size_t breakpoints; // Number of addresses with CHIP8_DEBUG_BREAK set
+    size_t watchpoints; // Number of addresses with a watch flag set
+    bool stopped; // Execution is paused until the client steps or continues
+    bool resuming; // Skip the breakpoint at the current pc once after a resume
+    int listen_fd;
+    int client_fd;
+    char line[CHIP8_DEBUGGER_LINE_SIZE]; // Partial command received from the client
+    size_t line_len;
+    bool discarding; // The current line is too long, its bytes are dropped up to the next newline
+} Chip8Debugger;
+
+Chip8Debugger Chip8DebuggerInit(void);
+bool Chip8DebuggerListen(Chip8Debugger *debugger, const char *socket_path); // Open a local Unix socket for a client to attach to
+void Chip8DebuggerClose(Chip8Debugger *debugger, const char *socket_path);
+bool Chip8DebuggerSetFlags(Chip8Debugger *debugger, uint16_t addr, size_t len, uint8_t flags);
+bool Chip8DebuggerClearFlags(Chip8Debugger *debugger, uint16_t addr, size_t len, uint8_t flags);
+void Chip8DebuggerPoll(Chip8Debugger *debugger, Chip8State *state); // Accept a client and serve pending commands, never blocks
+Chip8Res Chip8DebugCycle(Chip8Debugger *debugger, Chip8State *state); // Like Chip8MakeCycle, but honours breakpoints and watchpoints
+
+// True when cycles must go through Chip8DebugCycle, Chip8MakeCycle can be used otherwise
+static inline bool Chip8DebuggerArmed(Chip8Debugger const *const debugger) {
+    return debugger->breakpoints > 0 || debugger->watchpoints > 0;
+}
+
+#endif // CHIP8_DEBUGGER_H_
@@ -0,0 +1,58 @@
+#ifndef CHIP8_FRAME_H_
+#define CHIP8_FRAME_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "raylib.h"
+
+typedef enum Chip8Filter {
+    CHIP8_FILTER_NEAREST,
+    CHIP8_FILTER_SCALE2X,
+    CHIP8_FILTER_SCALE3X,
+} Chip8Filter;
+
+typedef struct Chip8Upscaler {
+    int src_width;
+    int src_height;
+    int factor; // Output pixels per source pixel, a multiple of 2 or 3 for the Scale2x/3x filters
+    int width; // Output size
+    int height;
+    Chip8Filter filter;
+    bool scanlines; // Darken the last row of every output pixel
+    uint32_t palette[4]; // off, on, dark off, dark on, packed as RGBA bytes
+    uint8_t *mask; // Filtered image, one 0x00/0xff byte per pixel
+    uint8_t *row; // One mask row stretched to the output width
+    uint8_t *rgba; // Output image, 4 bytes per pixel
+} Chip8Upscaler;
+
+typedef enum Chip8ExportFormat {
+    CHIP8_EXPORT_Y4M, // YUV4MPEG2 stream, 4:4:4
+    CHIP8_EXPORT_RAW, // Headerless RGBA frames one after the other
+    CHIP8_EXPORT_PNG, // One PNG per frame, named <path without extension>_<frame>.png
+} Chip8ExportFormat;
+
+typedef struct Chip8FrameExporter {
+    Chip8Upscaler *upscaler;
+    Chip8ExportFormat format;
+    FILE *file;
+    const char *path;
+    bool skip_unchanged; // Drop frames equal to the previous one instead of repeating them
+    bool *last_screen; // Copy of the previous source frame
+    uint8_t *yuv; // Y4M planes of the previous frame
+    size_t frame; // Frames submitted so far
+    size_t written; // Frames actually emitted
+    size_t encoded_frame; // Number of the last PNG actually encoded, repeated frames are hard links to it
+} Chip8FrameExporter;
+
+bool Chip8UpscalerInit(Chip8Upscaler *upscaler, int width, int height, Chip8Filter filter, int factor, bool scanlines, Color on, Color off);
+void Chip8UpscalerFree(Chip8Upscaler *upscaler);
+const uint8_t *Chip8Upscale(Chip8Upscaler *upscaler, const bool *screen); // screen is a row major width * height buffer, returns the RGBA output
+
+bool Chip8ExporterOpen(Chip8FrameExporter *exporter, Chip8Upscaler *upscaler, const char *path, Chip8ExportFormat format, int fps, bool skip_unchanged);
+bool Chip8ExporterWrite(Chip8FrameExporter *exporter, const bool *screen);
+void Chip8ExporterClose(Chip8FrameExporter *exporter);
+
+#endif // CHIP8_FRAME_H_
@@ -0,0 +1,57 @@
+#ifndef CHIP8_LIBRARY_H_
+#define CHIP8_LIBRARY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHIP8_SHA1_SIZE 20
+#define CHIP8_PLATFORM_SIZE 16
+#define CHIP8_ROM_NAME_SIZE 64
+
+typedef enum Chip8Quirk { // Behaviours that differ between interpreters, combined in Chip8RomSettings.quirks
+    CHIP8_QUIRK_SHIFT = 1 << 0, // 8XY6/8XYE shift VX in place instead of copying VY
+    CHIP8_QUIRK_JUMP = 1 << 1, // BXNN jumps to XNN + VX instead of NNN + V0
+    CHIP8_QUIRK_MEMORY = 1 << 2, // FX55/FX65 leave the index register unchanged
+    CHIP8_QUIRK_VBLANK = 1 << 3, // DXYN waits for the next frame
+    CHIP8_QUIRK_CLIP = 1 << 4, // Sprites are clipped at the screen edges instead of wrapping
+} Chip8Quirk;
+
+typedef struct Chip8RomSettings { // One entry of the ROM database
+    uint8_t sha1[CHIP8_SHA1_SIZE];
+    char platform[CHIP8_PLATFORM_SIZE]; // e.g. "chip8", "schip", "xochip"
+    int ips; // Instructions per second, 0 when unknown
+    unsigned quirks;
+    char name[CHIP8_ROM_NAME_SIZE];
+} Chip8RomSettings;
+
+typedef struct Chip8RomInfo { // One file of the library index
+    char *path;
+    uint8_t sha1[CHIP8_SHA1_SIZE];
+    long long size;
+    long long mtime_sec;
+    long mtime_nsec;
+} Chip8RomInfo;
+
+typedef struct Chip8Library {
+    Chip8RomInfo *roms; // Sorted by path
+    size_t rom_count;
+    Chip8RomSettings *database; // Sorted by hash
+    size_t database_count;
+    size_t hashed; // Files hashed instead of taken from the index, the index needs saving when non zero
+} Chip8Library;
+
+Chip8Library Chip8LibraryInit(void);
+void Chip8LibraryFree(Chip8Library *library);
+bool Chip8LibraryLoadDatabase(Chip8Library *library, const char *path); // Lines of "<sha1> <platform> <ips> <quirk,...|-> <name>"
+bool Chip8LibraryLoadIndex(Chip8Library *library, const char *path);
+bool Chip8LibrarySaveIndex(Chip8Library const *const library, const char *path);
+bool Chip8LibraryScan(Chip8Library *library, const char *directory, int threads); // Only files that are new or changed since the index are hashed
+const Chip8RomInfo *Chip8LibraryFind(Chip8Library *library, const char *path); // Hash path unless the index is up to date for it
+const Chip8RomSettings *Chip8LibraryLookup(Chip8Library const *const library, const uint8_t sha1[CHIP8_SHA1_SIZE]);
+bool Chip8SettingsMatchBuild(Chip8RomSettings const *const settings); // False when the ROM needs quirks this build was not compiled with
+
+bool Chip8HashFile(const char *path, uint8_t sha1[CHIP8_SHA1_SIZE]);
+void Chip8FormatHash(const uint8_t sha1[CHIP8_SHA1_SIZE], char hex[CHIP8_SHA1_SIZE * 2 + 1]);
+
+#endif // CHIP8_LIBRARY_H_
@@ -0,0 +1,331 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "chip8/debugger.h"
+
+/*
+ * Line based protocol, numbers are hexadecimal:
+ *   b ADDR              set a breakpoint          B ADDR              remove it
+ *   w ADDR LEN [r|w|a]  watch FX33/FX55/FX65      W ADDR LEN          remove it
+ *   s                   single step               c                   continue
+ *   h                   stop execution            r                   dump registers
+ *   m ADDR LEN          dump memory
+ * Every command is answered with "OK", "E" or the requested data; when execution
+ * stops the client receives "S <reason> <pc> [<addr>]".
+ */
+
+static void detach(Chip8Debugger *debugger) {
+    close(debugger->client_fd);
+    debugger->client_fd = -1;
+    debugger->line_len = 0;
+    debugger->discarding = false;
+
+    // Leaving no breakpoints behind puts the interpreter back on the plain Chip8MakeCycle path
+    memset(debugger->flags, 0, sizeof(debugger->flags));
+    debugger->breakpoints = 0;
+    debugger->watchpoints = 0;
+    debugger->stopped = false;
+    debugger->resuming = false;
+}
+
+// Remove a stale socket left by a previous run, but never a regular file or the socket of a running emulator
+static bool remove_stale_socket(const struct sockaddr_un *addr) {
+    struct stat info;
+    if (lstat(addr->sun_path, &info) < 0) return errno == ENOENT;
+    if (!S_ISSOCK(info.st_mode)) return false;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    bool alive = connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == 0;
+    close(fd);
+    if (alive) return false;
+
+    return unlink(addr->sun_path) == 0;
+}
+
+static void send_line(Chip8Debugger *debugger, const char *format, ...) {
+    if (debugger->client_fd < 0) return;
+
+    char buffer[CHIP8_DEBUGGER_LINE_SIZE * 4];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer) - 1, format, args);
+    va_end(args);
+    if (len < 0) return;
+    if ((size_t)len > sizeof(buffer) - 2) len = sizeof(buffer) - 2;
+    buffer[len++] = '\n';
+
+    if (send(debugger->client_fd, buffer, len, MSG_NOSIGNAL) < 0 && errno != EAGAIN) {
+        detach(debugger);
+    }
+}
+
+static void stop(Chip8Debugger *debugger, const char *reason, uint16_t pc, uint16_t addr) {
+    debugger->stopped = true;
+    if (pc == addr) {
+        send_line(debugger, "S %s %03X", reason, pc);
+    } else {
+        send_line(debugger, "S %s %03X %03X", reason, pc, addr);
+    }
+}
+
+static bool set_flags(Chip8Debugger *debugger, uint16_t addr, size_t len, uint8_t flags, bool set) {
+    if (!debugger || addr >= MAX_MEM || len == 0 || len > (size_t)(MAX_MEM - addr)) return false;
+
+    for (size_t i = addr; i < addr + len; ++i) {
+        uint8_t old = debugger->flags[i];
+        uint8_t new = set ? (old | flags) : (old & ~flags);
+        debugger->flags[i] = new;
+
+        if ((old & CHIP8_DEBUG_BREAK) != (new & CHIP8_DEBUG_BREAK)) {
+            if (new & CHIP8_DEBUG_BREAK) debugger->breakpoints++;
+            else debugger->breakpoints--;
+        }
+
+        uint8_t watch = CHIP8_DEBUG_WATCH_READ | CHIP8_DEBUG_WATCH_WRITE;
+        if (!(old & watch) != !(new & watch)) {
+            if (new & watch) debugger->watchpoints++;
+            else debugger->watchpoints--;
+        }
+    }
+    return true;
+}
+
+// Find the first watched address touched by the instruction at pc, only FX33/FX55/FX65 access memory through ir
+static bool check_watchpoints(Chip8Debugger *debugger, Chip8State *const state, uint16_t *hit) {
+    if (state->pc >= MAX_MEM - 1) return false;
+
+    Chip8Inst instruction = ((uint16_t)state->memory[state->pc] << 8) | state->memory[state->pc + 1];
+    if ((instruction & 0xf000) != 0xf000) return false;
+
+    uint8_t reg = (instruction & 0x0f00) >> 8;
+    size_t count;
+    uint8_t flag;
+    switch (instruction & 0x00ff) {
+        case 0x33: count = 3; flag = CHIP8_DEBUG_WATCH_WRITE; break;
+        case 0x55: count = reg + 1; flag = CHIP8_DEBUG_WATCH_WRITE; break;
+        case 0x65: count = reg + 1; flag = CHIP8_DEBUG_WATCH_READ; break;
+        default: return false;
+    }
+
+    for (size_t i = state->ir; i < (size_t)state->ir + count && i < MAX_MEM; ++i) {
+        if (debugger->flags[i] & flag) {
+            *hit = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void send_registers(Chip8Debugger *debugger, Chip8State *const state) {
+    char buffer[CHIP8_DEBUGGER_LINE_SIZE];
+    size_t len = 0;
+    for (int i = 0; i < REGISTERS; ++i) {
+        len += snprintf(buffer + len, sizeof(buffer) - len, "V%X=%02X ", i, state->registers[i]);
+    }
+    snprintf(buffer + len, sizeof(buffer) - len, "I=%03X PC=%03X SP=%zu DT=%02X ST=%02X",
+             state->ir, state->pc, state->sp, state->delay_timer, state->sound_timer);
+    send_line(debugger, "%s", buffer);
+}
+
+static void send_memory(Chip8Debugger *debugger, Chip8State *const state, unsigned addr, unsigned len) {
+    if (addr >= MAX_MEM || len == 0 || len > MAX_MEM - addr || len > CHIP8_DEBUGGER_LINE_SIZE) {
+        send_line(debugger, "E");
+        return;
+    }
+
+    char buffer[CHIP8_DEBUGGER_LINE_SIZE * 2 + 1];
+    for (size_t i = 0; i < len; ++i) {
+        snprintf(&buffer[i * 2], 3, "%02X", state->memory[addr + i]);
+    }
+    send_line(debugger, "%s", buffer);
+}
+
+static void handle_command(Chip8Debugger *debugger, Chip8State *state, const char *line) {
+    char command = 0;
+    unsigned addr = 0;
+    unsigned len = 1;
+    char kind[2] = "a";
+    int fields = sscanf(line, " %c %x %x %1s", &command, &addr, &len, kind);
+    if (fields < 1) return;
+
+    uint8_t watch = 0;
+    if (kind[0] == 'a') watch = CHIP8_DEBUG_WATCH_READ | CHIP8_DEBUG_WATCH_WRITE;
+    if (kind[0] == 'r') watch = CHIP8_DEBUG_WATCH_READ;
+    if (kind[0] == 'w') watch = CHIP8_DEBUG_WATCH_WRITE;
+
+    bool ok = true;
+    bool has_addr = fields >= 2 && addr < MAX_MEM;
+    bool has_len = has_addr && fields >= 3; // Watch commands always take a length, "w ADDR r" is an error
+    switch (command) {
+        case 'b': ok = has_addr && set_flags(debugger, addr, 1, CHIP8_DEBUG_BREAK, true); break;
+        case 'B': ok = has_addr && set_flags(debugger, addr, 1, CHIP8_DEBUG_BREAK, false); break;
+        case 'w': ok = has_len && watch && set_flags(debugger, addr, len, watch, true); break;
+        case 'W': ok = has_len && set_flags(debugger, addr, len, CHIP8_DEBUG_WATCH_READ | CHIP8_DEBUG_WATCH_WRITE, false); break;
+
+        case 's': {
+                uint16_t pc = state->pc;
+                uint16_t hit = pc;
+                bool watched = check_watchpoints(debugger, state, &hit);
+                if (Chip8MakeCycle(state) == CHIP8_ERROR) {
+                    stop(debugger, "ERROR", pc, pc);
+                } else if (watched) {
+                    stop(debugger, "WATCH", pc, hit);
+                } else {
+                    stop(debugger, "STEP", state->pc, state->pc);
+                }
+            } return;
+
+        case 'c': {
+                debugger->resuming = debugger->stopped;
+                debugger->stopped = false;
+            } break;
+
+        case 'h': {
+                stop(debugger, "HALT", state->pc, state->pc);
+            } return;
+
+        case 'r': send_registers(debugger, state); return;
+        case 'm': {
+                if (fields < 3) len = 16;
+                send_memory(debugger, state, addr, len);
+            } return;
+
+        default:
+            ok = false;
+            break;
+    }
+
+    send_line(debugger, ok ? "OK" : "E");
+}
+
+Chip8Debugger Chip8DebuggerInit(void) {
+    Chip8Debugger debugger = {
+        .flags = {0},
+        .breakpoints = 0,
+        .watchpoints = 0,
+        .stopped = false,
+        .resuming = false,
+        .listen_fd = -1,
+        .client_fd = -1,
+        .line = {0},
+        .line_len = 0,
+        .discarding = false,
+    };
+
+    return debugger;
+}
+
+bool Chip8DebuggerListen(Chip8Debugger *debugger, const char *socket_path) {
+    if (!debugger || !socket_path) return false;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, socket_path);
+
+    if (!remove_stale_socket(&addr)) return false;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+        close(fd);
+        return false;
+    }
+
+    debugger->listen_fd = fd;
+    return true;
+}
+
+void Chip8DebuggerClose(Chip8Debugger *debugger, const char *socket_path) {
+    if (!debugger) return;
+
+    if (debugger->client_fd >= 0) detach(debugger);
+    if (debugger->listen_fd >= 0) {
+        close(debugger->listen_fd);
+        debugger->listen_fd = -1;
+        if (socket_path) unlink(socket_path);
+    }
+}
+
+bool Chip8DebuggerSetFlags(Chip8Debugger *debugger, uint16_t addr, size_t len, uint8_t flags) {
+    return set_flags(debugger, addr, len, flags, true);
+}
+
+bool Chip8DebuggerClearFlags(Chip8Debugger *debugger, uint16_t addr, size_t len, uint8_t flags) {
+    return set_flags(debugger, addr, len, flags, false);
+}
+
+void Chip8DebuggerPoll(Chip8Debugger *debugger, Chip8State *state) {
+    if (!debugger || !state || debugger->listen_fd < 0) return;
+
+    if (debugger->client_fd < 0) {
+        int fd = accept(debugger->listen_fd, NULL, NULL);
+        if (fd < 0) return;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        debugger->client_fd = fd;
+        stop(debugger, "ATTACH", state->pc, state->pc);
+    }
+
+    char buffer[CHIP8_DEBUGGER_LINE_SIZE];
+    ssize_t received;
+    while ((received = recv(debugger->client_fd, buffer, sizeof(buffer), 0)) > 0) {
+        for (ssize_t i = 0; i < received; ++i) {
+            if (buffer[i] == '\n') {
+                debugger->line[debugger->line_len] = '\0';
+                debugger->line_len = 0;
+                if (debugger->discarding) {
+                    debugger->discarding = false;
+                } else {
+                    handle_command(debugger, state, debugger->line);
+                }
+                if (debugger->client_fd < 0) return;
+            } else if (debugger->discarding) {
+                continue;
+            } else if (debugger->line_len == CHIP8_DEBUGGER_LINE_SIZE - 1) {
+                // An over-long line is answered once and none of it is run as a command
+                debugger->line_len = 0;
+                debugger->discarding = true;
+                send_line(debugger, "E");
+                if (debugger->client_fd < 0) return;
+            } else {
+                debugger->line[debugger->line_len++] = buffer[i];
+            }
+        }
+    }
+
+    if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+        detach(debugger);
+    }
+}
+
+Chip8Res Chip8DebugCycle(Chip8Debugger *debugger, Chip8State *state) {
+    if (!debugger || !state) return CHIP8_ERROR;
+    if (debugger->stopped) return CHIP8_BREAK;
+
+    uint16_t pc = state->pc;
+    if (debugger->resuming) {
+        debugger->resuming = false;
+    } else if (pc < MAX_MEM && (debugger->flags[pc] & CHIP8_DEBUG_BREAK)) {
+        stop(debugger, "BREAK", pc, pc);
+        return CHIP8_BREAK;
+    }
+
+    uint16_t hit = 0;
+    if (debugger->watchpoints > 0 && check_watchpoints(debugger, state, &hit)) {
+        Chip8Res res = Chip8MakeCycle(state);
+        stop(debugger, "WATCH", pc, hit);
+        return res == CHIP8_ERROR ? res : CHIP8_BREAK;
+    }
+
+    return Chip8MakeCycle(state);
+}
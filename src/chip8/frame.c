@@ -0,0 +1,404 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "chip8/frame.h"
+
+#define PALETTE_OFF 0
+#define PALETTE_ON 1
+#define PALETTE_DARK_OFF 2
+#define PALETTE_DARK_ON 3
+
+#define FILENAME_SIZE 4096
+
+static inline uint32_t pack_color(Color color) {
+    uint32_t packed;
+    memcpy(&packed, &color, sizeof(packed));
+    return packed;
+}
+
+static inline Color darken(Color color) {
+    return (Color){ color.r / 2, color.g / 2, color.b / 2, color.a };
+}
+
+static inline int filter_base(Chip8Filter filter) {
+    switch (filter) {
+        case CHIP8_FILTER_SCALE2X: return 2;
+        case CHIP8_FILTER_SCALE3X: return 3;
+        default: return 1;
+    }
+}
+
+// Source pixel with the coordinates clamped to the screen, as the Scale2x/3x reference does
+static inline bool pixel_at(const bool *screen, int width, int height, int x, int y) {
+    if (x < 0) x = 0;
+    if (x >= width) x = width - 1;
+    if (y < 0) y = 0;
+    if (y >= height) y = height - 1;
+    return screen[y * width + x];
+}
+
+static void filter_nearest(Chip8Upscaler *upscaler, const bool *screen) {
+    size_t count = (size_t)upscaler->src_width * upscaler->src_height;
+    for (size_t i = 0; i < count; ++i) {
+        upscaler->mask[i] = screen[i] ? 0xff : 0x00;
+    }
+}
+
+static void filter_scale2x(Chip8Upscaler *upscaler, const bool *screen) {
+    int w = upscaler->src_width;
+    int h = upscaler->src_height;
+    size_t stride = (size_t)w * 2;
+
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            bool b = pixel_at(screen, w, h, x, y - 1);
+            bool d = pixel_at(screen, w, h, x - 1, y);
+            bool e = screen[y * w + x];
+            bool f = pixel_at(screen, w, h, x + 1, y);
+            bool hh = pixel_at(screen, w, h, x, y + 1);
+
+            bool e0 = e, e1 = e, e2 = e, e3 = e;
+            if (b != hh && d != f) {
+                e0 = d == b ? d : e;
+                e1 = b == f ? f : e;
+                e2 = d == hh ? d : e;
+                e3 = hh == f ? f : e;
+            }
+
+            uint8_t *out = &upscaler->mask[(size_t)y * 2 * stride + (size_t)x * 2];
+            out[0] = e0 ? 0xff : 0x00;
+            out[1] = e1 ? 0xff : 0x00;
+            out[stride] = e2 ? 0xff : 0x00;
+            out[stride + 1] = e3 ? 0xff : 0x00;
+        }
+    }
+}
+
+static void filter_scale3x(Chip8Upscaler *upscaler, const bool *screen) {
+    int w = upscaler->src_width;
+    int h = upscaler->src_height;
+    size_t stride = (size_t)w * 3;
+
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            bool a = pixel_at(screen, w, h, x - 1, y - 1);
+            bool b = pixel_at(screen, w, h, x, y - 1);
+            bool c = pixel_at(screen, w, h, x + 1, y - 1);
+            bool d = pixel_at(screen, w, h, x - 1, y);
+            bool e = screen[y * w + x];
+            bool f = pixel_at(screen, w, h, x + 1, y);
+            bool g = pixel_at(screen, w, h, x - 1, y + 1);
+            bool hh = pixel_at(screen, w, h, x, y + 1);
+            bool i = pixel_at(screen, w, h, x + 1, y + 1);
+
+            bool out[9] = { e, e, e, e, e, e, e, e, e };
+            if (b != hh && d != f) {
+                out[0] = d == b ? d : e;
+                out[1] = (d == b && e != c) || (b == f && e != a) ? b : e;
+                out[2] = b == f ? f : e;
+                out[3] = (d == b && e != g) || (d == hh && e != a) ? d : e;
+                out[5] = (b == f && e != i) || (hh == f && e != c) ? f : e;
+                out[6] = d == hh ? d : e;
+                out[7] = (d == hh && e != i) || (hh == f && e != g) ? hh : e;
+                out[8] = hh == f ? f : e;
+            }
+
+            uint8_t *dst = &upscaler->mask[(size_t)y * 3 * stride + (size_t)x * 3];
+            for (int row = 0; row < 3; ++row) {
+                for (int col = 0; col < 3; ++col) {
+                    dst[row * stride + col] = out[row * 3 + col] ? 0xff : 0x00;
+                }
+            }
+        }
+    }
+}
+
+// Turn a row of 0x00/0xff mask bytes into RGBA pixels, selecting between two packed colors
+static void map_row(const uint8_t *mask, size_t count, uint32_t off, uint32_t on, uint32_t *out) {
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    __m256i off_v = _mm256_set1_epi32((int)off);
+    __m256i on_v = _mm256_set1_epi32((int)on);
+    for (; i + 8 <= count; i += 8) {
+        __m256i select = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)&mask[i]));
+        _mm256_storeu_si256((__m256i *)&out[i], _mm256_blendv_epi8(off_v, on_v, select));
+    }
+#elif defined(__SSE2__)
+    __m128i off_v = _mm_set1_epi32((int)off);
+    __m128i on_v = _mm_set1_epi32((int)on);
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)&mask[i]);
+        __m128i lo = _mm_unpacklo_epi8(bytes, bytes);
+        __m128i hi = _mm_unpackhi_epi8(bytes, bytes);
+        __m128i select[4] = {
+            _mm_unpacklo_epi16(lo, lo),
+            _mm_unpackhi_epi16(lo, lo),
+            _mm_unpacklo_epi16(hi, hi),
+            _mm_unpackhi_epi16(hi, hi),
+        };
+        for (int j = 0; j < 4; ++j) {
+            __m128i pixels = _mm_or_si128(_mm_and_si128(select[j], on_v), _mm_andnot_si128(select[j], off_v));
+            _mm_storeu_si128((__m128i *)&out[i + j * 4], pixels);
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        out[i] = mask[i] ? on : off;
+    }
+}
+
+bool Chip8UpscalerInit(Chip8Upscaler *upscaler, int width, int height, Chip8Filter filter, int factor, bool scanlines, Color on, Color off) {
+    if (!upscaler || width <= 0 || height <= 0 || factor <= 0) return false;
+
+    int base = filter_base(filter);
+    if (factor % base != 0) return false;
+    if (factor > INT_MAX / width || factor > INT_MAX / height) return false;
+
+    upscaler->src_width = width;
+    upscaler->src_height = height;
+    upscaler->factor = factor;
+    upscaler->width = width * factor;
+    upscaler->height = height * factor;
+    upscaler->filter = filter;
+    upscaler->scanlines = scanlines;
+    upscaler->palette[PALETTE_OFF] = pack_color(off);
+    upscaler->palette[PALETTE_ON] = pack_color(on);
+    upscaler->palette[PALETTE_DARK_OFF] = pack_color(darken(off));
+    upscaler->palette[PALETTE_DARK_ON] = pack_color(darken(on));
+
+    upscaler->mask = malloc((size_t)width * base * height * base);
+    upscaler->row = malloc((size_t)upscaler->width);
+    upscaler->rgba = malloc((size_t)upscaler->width * upscaler->height * 4);
+    if (!upscaler->mask || !upscaler->row || !upscaler->rgba) {
+        Chip8UpscalerFree(upscaler);
+        return false;
+    }
+
+    return true;
+}
+
+void Chip8UpscalerFree(Chip8Upscaler *upscaler) {
+    if (!upscaler) return;
+    free(upscaler->mask);
+    free(upscaler->row);
+    free(upscaler->rgba);
+    upscaler->mask = NULL;
+    upscaler->row = NULL;
+    upscaler->rgba = NULL;
+}
+
+const uint8_t *Chip8Upscale(Chip8Upscaler *upscaler, const bool *screen) {
+    if (!upscaler || !screen || !upscaler->rgba) return NULL;
+
+    switch (upscaler->filter) {
+        case CHIP8_FILTER_SCALE2X: filter_scale2x(upscaler, screen); break;
+        case CHIP8_FILTER_SCALE3X: filter_scale3x(upscaler, screen); break;
+        default: filter_nearest(upscaler, screen); break;
+    }
+
+    // The filtered mask is stretched by the remaining factor, each distinct row is colored once and then copied
+    int base = filter_base(upscaler->filter);
+    int repeat = upscaler->factor / base;
+    size_t mask_width = (size_t)upscaler->src_width * base;
+    size_t row_bytes = (size_t)upscaler->width * 4;
+    bool scanlines = upscaler->scanlines && upscaler->factor > 1;
+
+    for (int y = 0; y < upscaler->src_height * base; ++y) {
+        const uint8_t *mask = &upscaler->mask[y * mask_width];
+        for (size_t x = 0; x < mask_width; ++x) {
+            memset(&upscaler->row[x * repeat], mask[x], repeat);
+        }
+
+        uint8_t *bright = NULL;
+        uint8_t *dark = NULL;
+        for (int r = 0; r < repeat; ++r) {
+            int out_y = y * repeat + r;
+            bool is_dark = scanlines && out_y % upscaler->factor == upscaler->factor - 1;
+            uint8_t **cached = is_dark ? &dark : &bright;
+            uint8_t *out = &upscaler->rgba[out_y * row_bytes];
+
+            if (*cached) {
+                memcpy(out, *cached, row_bytes);
+            } else {
+                uint32_t off = upscaler->palette[is_dark ? PALETTE_DARK_OFF : PALETTE_OFF];
+                uint32_t on = upscaler->palette[is_dark ? PALETTE_DARK_ON : PALETTE_ON];
+                map_row(upscaler->row, upscaler->width, off, on, (uint32_t *)out);
+                *cached = out;
+            }
+        }
+    }
+
+    return upscaler->rgba;
+}
+
+// BT.601 limited range, written as three planes for the C444 colorspace
+static void rgba_to_yuv(const uint8_t *rgba, size_t count, uint8_t *yuv) {
+    uint8_t *y_plane = yuv;
+    uint8_t *u_plane = yuv + count;
+    uint8_t *v_plane = yuv + count * 2;
+
+    for (size_t i = 0; i < count; ++i) {
+        int r = rgba[i * 4];
+        int g = rgba[i * 4 + 1];
+        int b = rgba[i * 4 + 2];
+        y_plane[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        u_plane[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        v_plane[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+}
+
+static void png_filename(Chip8FrameExporter const *const exporter, size_t frame, char filename[FILENAME_SIZE]) {
+    const char *extension = strrchr(exporter->path, '.');
+    int stem = extension ? (int)(extension - exporter->path) : (int)strlen(exporter->path);
+    snprintf(filename, FILENAME_SIZE, "%.*s_%06zu.png", stem, exporter->path, frame);
+}
+
+// A repeated frame gets the file of the last encoded one, hard linked or copied when links are not supported
+static bool repeat_png(Chip8FrameExporter *exporter) {
+    char source[FILENAME_SIZE];
+    char filename[FILENAME_SIZE];
+    png_filename(exporter, exporter->encoded_frame, source);
+    png_filename(exporter, exporter->frame, filename);
+
+    unlink(filename);
+    if (link(source, filename) == 0) return true;
+
+    FILE *in = fopen(source, "rb");
+    if (!in) return false;
+    FILE *out = fopen(filename, "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+
+    char buffer[FILENAME_SIZE];
+    size_t read;
+    bool ok = true;
+    while (ok && (read = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        ok = fwrite(buffer, 1, read, out) == read;
+    }
+    if (ferror(in)) ok = false;
+    fclose(in);
+    if (fclose(out) != 0) ok = false;
+    return ok;
+}
+
+static bool export_png(Chip8FrameExporter *exporter) {
+    char filename[FILENAME_SIZE];
+    png_filename(exporter, exporter->frame, filename);
+
+    Image image = {
+        .data = exporter->upscaler->rgba,
+        .width = exporter->upscaler->width,
+        .height = exporter->upscaler->height,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+    return ExportImage(image, filename);
+}
+
+bool Chip8ExporterOpen(Chip8FrameExporter *exporter, Chip8Upscaler *upscaler, const char *path, Chip8ExportFormat format, int fps, bool skip_unchanged) {
+    if (!exporter || !upscaler || !path || fps <= 0) return false;
+
+    *exporter = (Chip8FrameExporter){
+        .upscaler = upscaler,
+        .format = format,
+        .file = NULL,
+        .path = path,
+        .skip_unchanged = skip_unchanged,
+        .last_screen = NULL,
+        .yuv = NULL,
+        .frame = 0,
+        .written = 0,
+        .encoded_frame = 0,
+    };
+
+    size_t pixels = (size_t)upscaler->width * upscaler->height;
+    exporter->last_screen = malloc((size_t)upscaler->src_width * upscaler->src_height * sizeof(bool));
+    if (!exporter->last_screen) return false;
+
+    if (format == CHIP8_EXPORT_PNG) return true;
+
+    exporter->file = fopen(path, "wb");
+    if (!exporter->file) {
+        Chip8ExporterClose(exporter);
+        return false;
+    }
+
+    if (format == CHIP8_EXPORT_Y4M) {
+        exporter->yuv = malloc(pixels * 3);
+        if (!exporter->yuv) {
+            Chip8ExporterClose(exporter);
+            return false;
+        }
+        fprintf(exporter->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", upscaler->width, upscaler->height, fps);
+    }
+
+    return true;
+}
+
+bool Chip8ExporterWrite(Chip8FrameExporter *exporter, const bool *screen) {
+    if (!exporter || !exporter->upscaler || !screen) return false;
+
+    Chip8Upscaler *upscaler = exporter->upscaler;
+    size_t screen_size = (size_t)upscaler->src_width * upscaler->src_height * sizeof(bool);
+    size_t pixels = (size_t)upscaler->width * upscaler->height;
+
+    // Unchanged frames are either dropped or written again from the buffers of the previous one
+    bool unchanged = exporter->frame > 0 && memcmp(exporter->last_screen, screen, screen_size) == 0;
+    exporter->frame++;
+    if (unchanged && exporter->skip_unchanged) return true;
+
+    if (!unchanged) {
+        memcpy(exporter->last_screen, screen, screen_size);
+        Chip8Upscale(upscaler, screen);
+        if (exporter->format == CHIP8_EXPORT_Y4M) rgba_to_yuv(upscaler->rgba, pixels, exporter->yuv);
+    }
+
+    bool ok;
+    switch (exporter->format) {
+        case CHIP8_EXPORT_Y4M: {
+                ok = fputs("FRAME\n", exporter->file) >= 0 &&
+                     fwrite(exporter->yuv, 1, pixels * 3, exporter->file) == pixels * 3;
+            } break;
+        case CHIP8_EXPORT_RAW: {
+                ok = fwrite(upscaler->rgba, 1, pixels * 4, exporter->file) == pixels * 4;
+            } break;
+        case CHIP8_EXPORT_PNG: {
+                if (unchanged && exporter->encoded_frame > 0) {
+                    ok = repeat_png(exporter);
+                } else {
+                    ok = export_png(exporter);
+                    if (ok) exporter->encoded_frame = exporter->frame;
+                }
+            } break;
+        default:
+            ok = false;
+            break;
+    }
+
+    if (ok) exporter->written++;
+    return ok;
+}
+
+void Chip8ExporterClose(Chip8FrameExporter *exporter) {
+    if (!exporter) return;
+    if (exporter->file) fclose(exporter->file);
+    free(exporter->last_screen);
+    free(exporter->yuv);
+    exporter->file = NULL;
+    exporter->last_screen = NULL;
+    exporter->yuv = NULL;
+}
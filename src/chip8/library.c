@@ -0,0 +1,651 @@
+#define _XOPEN_SOURCE 700
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chip8/library.h"
+
+#define INDEX_MAGIC "C8INDEX 1"
+#define LINE_SIZE 4352
+#define MAX_THREADS 64
+
+// What chip8.c implements: FX55/FX65 never move I, DXYN always clips and never waits for vblank
+#ifdef ORIGINAL_CHIP8
+#define BUILD_PLATFORM "chip8"
+#define BUILD_QUIRKS (CHIP8_QUIRK_MEMORY | CHIP8_QUIRK_CLIP)
+#else
+#define BUILD_PLATFORM "schip"
+#define BUILD_QUIRKS (CHIP8_QUIRK_MEMORY | CHIP8_QUIRK_CLIP | CHIP8_QUIRK_SHIFT | CHIP8_QUIRK_JUMP)
+#endif
+#define INTERPRETER_QUIRKS (CHIP8_QUIRK_SHIFT | CHIP8_QUIRK_JUMP | CHIP8_QUIRK_MEMORY | CHIP8_QUIRK_VBLANK | CHIP8_QUIRK_CLIP)
+
+typedef struct Sha1 {
+    uint32_t h[5];
+    uint8_t block[64];
+    size_t block_len;
+    uint64_t length;
+} Sha1;
+
+static const struct {
+    const char *name;
+    Chip8Quirk quirk;
+} quirk_names[] = {
+    { "shift", CHIP8_QUIRK_SHIFT },
+    { "jump", CHIP8_QUIRK_JUMP },
+    { "memory", CHIP8_QUIRK_MEMORY },
+    { "vblank", CHIP8_QUIRK_VBLANK },
+    { "clip", CHIP8_QUIRK_CLIP },
+};
+
+static inline uint32_t rotl(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1_init(Sha1 *sha) {
+    *sha = (Sha1){
+        .h = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 },
+        .block = {0},
+        .block_len = 0,
+        .length = 0,
+    };
+}
+
+static void sha1_block(Sha1 *sha, const uint8_t *block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = sha->h[0], b = sha->h[1], c = sha->h[2], d = sha->h[3], e = sha->h[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    sha->h[0] += a;
+    sha->h[1] += b;
+    sha->h[2] += c;
+    sha->h[3] += d;
+    sha->h[4] += e;
+}
+
+static void sha1_update(Sha1 *sha, const uint8_t *data, size_t size) {
+    sha->length += size;
+
+    if (sha->block_len > 0) {
+        size_t take = 64 - sha->block_len < size ? 64 - sha->block_len : size;
+        memcpy(&sha->block[sha->block_len], data, take);
+        sha->block_len += take;
+        data += take;
+        size -= take;
+        if (sha->block_len < 64) return;
+        sha1_block(sha, sha->block);
+        sha->block_len = 0;
+    }
+
+    for (; size >= 64; data += 64, size -= 64) {
+        sha1_block(sha, data);
+    }
+
+    memcpy(sha->block, data, size);
+    sha->block_len = size;
+}
+
+static void sha1_final(Sha1 *sha, uint8_t digest[CHIP8_SHA1_SIZE]) {
+    uint64_t bits = sha->length * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t pad_len = (sha->block_len < 56 ? 56 : 120) - sha->block_len;
+    for (int i = 0; i < 8; ++i) {
+        padding[pad_len + i] = bits >> (56 - i * 8);
+    }
+    sha1_update(sha, padding, pad_len + 8);
+
+    for (int i = 0; i < 5; ++i) {
+        digest[i * 4] = sha->h[i] >> 24;
+        digest[i * 4 + 1] = sha->h[i] >> 16;
+        digest[i * 4 + 2] = sha->h[i] >> 8;
+        digest[i * 4 + 3] = sha->h[i];
+    }
+}
+
+static bool parse_hash(const char *hex, uint8_t sha1[CHIP8_SHA1_SIZE]) {
+    if (strlen(hex) != CHIP8_SHA1_SIZE * 2) return false;
+    for (int i = 0; i < CHIP8_SHA1_SIZE * 2; ++i) {
+        if (!isxdigit((unsigned char)hex[i])) return false;
+    }
+
+    for (int i = 0; i < CHIP8_SHA1_SIZE; ++i) {
+        unsigned byte;
+        if (sscanf(&hex[i * 2], "%2x", &byte) != 1) return false;
+        sha1[i] = byte;
+    }
+    return true;
+}
+
+static unsigned parse_quirks(char *list) {
+    unsigned quirks = 0;
+    if (strcmp(list, "-") == 0) return quirks;
+
+    for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        for (size_t i = 0; i < sizeof(quirk_names) / sizeof(quirk_names[0]); ++i) {
+            if (strcmp(name, quirk_names[i].name) == 0) quirks |= quirk_names[i].quirk;
+        }
+    }
+    return quirks;
+}
+
+static int compare_settings(const void *a, const void *b) {
+    return memcmp(((const Chip8RomSettings *)a)->sha1, ((const Chip8RomSettings *)b)->sha1, CHIP8_SHA1_SIZE);
+}
+
+static int compare_roms(const void *a, const void *b) {
+    return strcmp(((const Chip8RomInfo *)a)->path, ((const Chip8RomInfo *)b)->path);
+}
+
+static Chip8RomInfo *find_rom(Chip8RomInfo *roms, size_t count, const char *path) {
+    if (count == 0) return NULL;
+    Chip8RomInfo key = { .path = (char *)path };
+    return bsearch(&key, roms, count, sizeof(*roms), compare_roms);
+}
+
+static bool stat_rom(Chip8RomInfo *rom) {
+    struct stat info;
+    if (stat(rom->path, &info) < 0 || !S_ISREG(info.st_mode)) return false;
+    rom->size = info.st_size;
+    rom->mtime_sec = info.st_mtim.tv_sec;
+    rom->mtime_nsec = info.st_mtim.tv_nsec;
+    return true;
+}
+
+static inline bool same_file(Chip8RomInfo const *const a, Chip8RomInfo const *const b) {
+    return a->size == b->size && a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec;
+}
+
+static void free_roms(Chip8RomInfo *roms, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        free(roms[i].path);
+    }
+    free(roms);
+}
+
+typedef struct FileList {
+    char **paths;
+    size_t count;
+    size_t capacity;
+} FileList;
+
+static void free_files(FileList *files) {
+    for (size_t i = 0; i < files->count; ++i) {
+        free(files->paths[i]);
+    }
+    free(files->paths);
+    *files = (FileList){0};
+}
+
+static bool is_rom_name(const char *name) {
+    const char *extension = strrchr(name, '.');
+    return extension && extension != name && strcasecmp(extension, ".ch8") == 0;
+}
+
+// Append every .ch8 file below directory, false when some of the tree could not be listed. Symlinked
+// directories are not followed so a link cycle cannot recurse forever
+static bool list_roms(FileList *files, const char *directory) {
+    DIR *dir = opendir(directory);
+    if (!dir) return false;
+
+    bool complete = true;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name) >= (int)sizeof(path)) {
+            complete = false;
+            continue;
+        }
+        struct stat info;
+        if (lstat(path, &info) < 0) {
+            complete = false;
+            continue;
+        }
+
+        if (S_ISDIR(info.st_mode)) {
+            if (!list_roms(files, path)) complete = false;
+            continue;
+        }
+        if (!is_rom_name(entry->d_name)) continue;
+
+        if (files->count == files->capacity) {
+            size_t capacity = files->capacity ? files->capacity * 2 : 256;
+            char **grown = realloc(files->paths, capacity * sizeof(*grown));
+            if (!grown) {
+                complete = false;
+                break;
+            }
+            files->paths = grown;
+            files->capacity = capacity;
+        }
+        files->paths[files->count] = strdup(path);
+        if (!files->paths[files->count]) {
+            complete = false;
+            break;
+        }
+        files->count++;
+    }
+    closedir(dir);
+    return complete;
+}
+
+typedef struct HashJob {
+    Chip8RomInfo *roms;
+    size_t *pending; // Indices into roms that need hashing
+    size_t count;
+    atomic_size_t next;
+    bool *failed;
+} HashJob;
+
+static void *hash_worker(void *arg) {
+    HashJob *job = arg;
+    size_t i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+        Chip8RomInfo *rom = &job->roms[job->pending[i]];
+        job->failed[job->pending[i]] = !Chip8HashFile(rom->path, rom->sha1);
+    }
+    return NULL;
+}
+
+static void hash_parallel(HashJob *job, int threads) {
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if ((size_t)threads > job->count) threads = job->count;
+
+    pthread_t workers[MAX_THREADS];
+    int started = 0;
+    for (; started < threads - 1; ++started) {
+        if (pthread_create(&workers[started], NULL, hash_worker, job) != 0) break;
+    }
+    hash_worker(job);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+}
+
+Chip8Library Chip8LibraryInit(void) {
+    Chip8Library library = {
+        .roms = NULL,
+        .rom_count = 0,
+        .database = NULL,
+        .database_count = 0,
+        .hashed = 0,
+    };
+
+    return library;
+}
+
+void Chip8LibraryFree(Chip8Library *library) {
+    if (!library) return;
+    free_roms(library->roms, library->rom_count);
+    free(library->database);
+    *library = Chip8LibraryInit();
+}
+
+bool Chip8LibraryLoadDatabase(Chip8Library *library, const char *path) {
+    if (!library || !path) return false;
+
+    FILE *file = fopen(path, "r");
+    if (!file) return false;
+
+    char line[LINE_SIZE];
+    size_t capacity = library->database_count;
+    while (fgets(line, sizeof(line), file)) {
+        char hex[CHIP8_SHA1_SIZE * 2 + 1];
+        char quirks[128];
+        Chip8RomSettings settings = {0};
+        int name_start = 0;
+        if (line[0] == '#' ||
+            sscanf(line, "%40s %15s %d %127s %n", hex, settings.platform, &settings.ips, quirks, &name_start) < 4 ||
+            !parse_hash(hex, settings.sha1)) {
+            continue;
+        }
+        settings.quirks = parse_quirks(quirks);
+        if (name_start > 0) {
+            line[strcspn(line, "\r\n")] = '\0';
+            snprintf(settings.name, sizeof(settings.name), "%.*s", (int)sizeof(settings.name) - 1, &line[name_start]);
+        }
+
+        if (library->database_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            Chip8RomSettings *database = realloc(library->database, capacity * sizeof(*database));
+            if (!database) {
+                fclose(file);
+                return false;
+            }
+            library->database = database;
+        }
+        library->database[library->database_count++] = settings;
+    }
+    fclose(file);
+
+    qsort(library->database, library->database_count, sizeof(*library->database), compare_settings);
+    return true;
+}
+
+bool Chip8LibraryLoadIndex(Chip8Library *library, const char *path) {
+    if (!library || !path) return false;
+
+    FILE *file = fopen(path, "r");
+    if (!file) return false;
+
+    char line[LINE_SIZE];
+    if (!fgets(line, sizeof(line), file) || strncmp(line, INDEX_MAGIC, strlen(INDEX_MAGIC)) != 0) {
+        fclose(file);
+        return false;
+    }
+
+    Chip8RomInfo *roms = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    while (fgets(line, sizeof(line), file)) {
+        char hex[CHIP8_SHA1_SIZE * 2 + 1];
+        Chip8RomInfo rom = {0};
+        int path_start = 0;
+        if (sscanf(line, "%40s %lld %lld %ld %n", hex, &rom.size, &rom.mtime_sec, &rom.mtime_nsec, &path_start) < 4 ||
+            path_start == 0 || !parse_hash(hex, rom.sha1)) {
+            continue;
+        }
+        line[strcspn(line, "\n")] = '\0';
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            Chip8RomInfo *grown = realloc(roms, capacity * sizeof(*grown));
+            if (!grown) {
+                free_roms(roms, count);
+                fclose(file);
+                return false;
+            }
+            roms = grown;
+        }
+        rom.path = strdup(&line[path_start]);
+        if (!rom.path) {
+            free_roms(roms, count);
+            fclose(file);
+            return false;
+        }
+        roms[count++] = rom;
+    }
+    fclose(file);
+
+    if (count > 0) qsort(roms, count, sizeof(*roms), compare_roms);
+    free_roms(library->roms, library->rom_count);
+    library->roms = roms;
+    library->rom_count = count;
+    return true;
+}
+
+bool Chip8LibrarySaveIndex(Chip8Library const *const library, const char *path) {
+    if (!library || !path) return false;
+
+    // Written to a unique file next to the index and renamed over it, so neither an interrupted save nor
+    // concurrent emulators saving at once can leave a truncated or interleaved index
+    char temp_path[LINE_SIZE];
+    if (snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", path) >= (int)sizeof(temp_path)) return false;
+    int fd = mkstemp(temp_path);
+    if (fd < 0) return false;
+    fchmod(fd, 0644);
+    FILE *file = fdopen(fd, "w");
+    if (!file) {
+        close(fd);
+        remove(temp_path);
+        return false;
+    }
+
+    fprintf(file, "%s\n", INDEX_MAGIC);
+    for (size_t i = 0; i < library->rom_count; ++i) {
+        Chip8RomInfo const *const rom = &library->roms[i];
+        char hex[CHIP8_SHA1_SIZE * 2 + 1];
+        Chip8FormatHash(rom->sha1, hex);
+        fprintf(file, "%s %lld %lld %ld %s\n", hex, rom->size, rom->mtime_sec, rom->mtime_nsec, rom->path);
+    }
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) ok = false;
+    if (ok) ok = rename(temp_path, path) == 0;
+    if (!ok) remove(temp_path);
+    return ok;
+}
+
+bool Chip8LibraryScan(Chip8Library *library, const char *directory, int threads) {
+    if (!library || !directory) return false;
+
+    char *root = realpath(directory, NULL);
+    if (!root) return false;
+    struct stat info;
+    if (stat(root, &info) != 0 || !S_ISDIR(info.st_mode)) {
+        free(root);
+        return false;
+    }
+
+    FileList files = {0};
+    bool complete = list_roms(&files, root);
+    Chip8RomInfo *roms = calloc(files.count ? files.count : 1, sizeof(*roms));
+    size_t *pending = calloc(files.count ? files.count : 1, sizeof(*pending));
+    bool *failed = calloc(files.count ? files.count : 1, sizeof(*failed));
+    if (!roms || !pending || !failed) {
+        free(roms);
+        free(pending);
+        free(failed);
+        free(root);
+        free_files(&files);
+        return false;
+    }
+
+    size_t count = 0;
+    size_t pending_count = 0;
+    for (size_t i = 0; i < files.count; ++i) {
+        // Paths are stored canonical so a ROM is found however it is spelled when loaded
+        Chip8RomInfo rom = { .path = realpath(files.paths[i], NULL) };
+        if (!rom.path) continue;
+        if (!stat_rom(&rom)) {
+            free(rom.path);
+            continue;
+        }
+        roms[count++] = rom;
+    }
+    free_files(&files);
+
+    // Symlinks can resolve to a path already listed, keep one entry per canonical path
+    qsort(roms, count, sizeof(*roms), compare_roms);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (unique > 0 && strcmp(roms[unique - 1].path, roms[i].path) == 0) {
+            free(roms[i].path);
+            continue;
+        }
+        roms[unique++] = roms[i];
+    }
+    count = unique;
+
+    for (size_t i = 0; i < count; ++i) {
+        Chip8RomInfo *known = find_rom(library->roms, library->rom_count, roms[i].path);
+        if (known && same_file(known, &roms[i])) {
+            memcpy(roms[i].sha1, known->sha1, CHIP8_SHA1_SIZE);
+        } else {
+            pending[pending_count++] = i;
+        }
+    }
+
+    HashJob job = {
+        .roms = roms,
+        .pending = pending,
+        .count = pending_count,
+        .failed = failed,
+    };
+    atomic_init(&job.next, 0);
+    if (pending_count > 0) hash_parallel(&job, threads > 0 ? threads : 1);
+
+    // Drop files that could not be read and keep the index entries from outside the scanned directory, or from
+    // anywhere when part of the tree could not be listed since a missing file does not mean a deleted one then
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (failed[i]) {
+            free(roms[i].path);
+        } else {
+            roms[kept++] = roms[i];
+        }
+    }
+    free(pending);
+    free(failed);
+    qsort(roms, kept, sizeof(*roms), compare_roms);
+
+    Chip8RomInfo *grown = realloc(roms, (kept + library->rom_count + 1) * sizeof(*grown));
+    if (!grown) {
+        free_roms(roms, kept);
+        free(root);
+        return false;
+    }
+    roms = grown;
+
+    size_t scanned = kept;
+    size_t prefix_len = strlen(root);
+    for (size_t i = 0; i < library->rom_count; ++i) {
+        Chip8RomInfo *old = &library->roms[i];
+        bool inside = strncmp(old->path, root, prefix_len) == 0 &&
+                      (old->path[prefix_len] == '/' || root[prefix_len - 1] == '/');
+        if ((inside && complete) || find_rom(roms, scanned, old->path)) {
+            free(old->path);
+            continue;
+        }
+        roms[kept++] = *old;
+    }
+    free(library->roms);
+    free(root);
+    qsort(roms, kept, sizeof(*roms), compare_roms);
+
+    library->roms = roms;
+    library->rom_count = kept;
+    library->hashed += pending_count;
+    return true;
+}
+
+const Chip8RomInfo *Chip8LibraryFind(Chip8Library *library, const char *path) {
+    if (!library || !path) return NULL;
+
+    Chip8RomInfo rom = { .path = realpath(path, NULL) };
+    if (!rom.path) return NULL;
+    if (!stat_rom(&rom)) {
+        free(rom.path);
+        return NULL;
+    }
+
+    Chip8RomInfo *known = find_rom(library->roms, library->rom_count, rom.path);
+    if (known && same_file(known, &rom)) {
+        free(rom.path);
+        return known;
+    }
+
+    if (!Chip8HashFile(rom.path, rom.sha1)) {
+        free(rom.path);
+        return NULL;
+    }
+    library->hashed++;
+    if (known) {
+        memcpy(known->sha1, rom.sha1, CHIP8_SHA1_SIZE);
+        known->size = rom.size;
+        known->mtime_sec = rom.mtime_sec;
+        known->mtime_nsec = rom.mtime_nsec;
+        free(rom.path);
+        return known;
+    }
+
+    Chip8RomInfo *roms = realloc(library->roms, (library->rom_count + 1) * sizeof(*roms));
+    if (!roms) {
+        free(rom.path);
+        return NULL;
+    }
+    library->roms = roms;
+
+    size_t position = 0;
+    while (position < library->rom_count && strcmp(roms[position].path, rom.path) < 0) position++;
+    memmove(&roms[position + 1], &roms[position], (library->rom_count - position) * sizeof(*roms));
+    roms[position] = rom;
+    library->rom_count++;
+    return &roms[position];
+}
+
+const Chip8RomSettings *Chip8LibraryLookup(Chip8Library const *const library, const uint8_t sha1[CHIP8_SHA1_SIZE]) {
+    if (!library || !sha1 || library->database_count == 0) return NULL;
+
+    Chip8RomSettings key;
+    memcpy(key.sha1, sha1, CHIP8_SHA1_SIZE);
+    return bsearch(&key, library->database, library->database_count, sizeof(key), compare_settings);
+}
+
+bool Chip8SettingsMatchBuild(Chip8RomSettings const *const settings) {
+    if (!settings) return true;
+    return strcmp(settings->platform, BUILD_PLATFORM) == 0 && (settings->quirks & INTERPRETER_QUIRKS) == BUILD_QUIRKS;
+}
+
+bool Chip8HashFile(const char *path, uint8_t sha1[CHIP8_SHA1_SIZE]) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return false;
+    }
+
+    Sha1 sha;
+    sha1_init(&sha);
+    if (info.st_size > 0) {
+        void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        sha1_update(&sha, data, info.st_size);
+        munmap(data, info.st_size);
+    }
+    close(fd);
+
+    sha1_final(&sha, sha1);
+    return true;
+}
+
+void Chip8FormatHash(const uint8_t sha1[CHIP8_SHA1_SIZE], char hex[CHIP8_SHA1_SIZE * 2 + 1]) {
+    for (int i = 0; i < CHIP8_SHA1_SIZE; ++i) {
+        snprintf(&hex[i * 2], 3, "%02x", sha1[i]);
+    }
+}
@@ -1,10 +1,18 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "raylib.h"
 
-#define ORIGINAL_CHIP8
 #include "chip8/chip8.h"
+#include "chip8/debugger.h"
+#include "chip8/frame.h"
+#include "chip8/library.h"
 
 #define PIXEL_SIZE 10
 
@@ -13,6 +21,11 @@
 
 #define DEBUG
 
+#ifdef DEBUG
+// Attach with e.g. `socat - UNIX-CONNECT:./chip8-debug.sock`
+#define DEBUGGER_SOCKET "./chip8-debug.sock"
+#endif
+
 #define FPS 60
 
 // Instruction per second
@@ -20,6 +33,14 @@
 // Instruction per frame
 #define IPF (IPS/FPS)
 
+// Defaults of the headless frame export
+#define EXPORT_FRAMES (FPS * 10)
+#define EXPORT_FACTOR 6
+
+// Persistent hashes of the known ROMs and the settings matched against them
+#define LIBRARY_INDEX "./chip8-library.idx"
+#define ROM_DATABASE "./chip8-roms.db"
+
 void draw_screen_buffer(Chip8State *const state) {
     for (int i = 0; i < CHIP8_SCREEN_HEIGHT; ++i) {
         for (int j = 0; j < CHIP8_SCREEN_WIDTH; ++j) {
@@ -62,9 +83,188 @@ void StateStatus(Chip8State const *const state) {
     printf("Program Counter: %d\n", state->pc);
 }
 
+void tick_timers(Chip8State *state) {
+    if (state->delay_timer > 0) {
+        state->delay_timer--;
+    }
+    if (state->sound_timer > 0) {
+        state->sound_timer--;
+    }
+}
+
+// Parse a whole decimal argument that fits an int and is not negative
+bool parse_count(const char *text, int *value) {
+    char *end = NULL;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < 0 || parsed > INT_MAX) return false;
+    *value = (int)parsed;
+    return true;
+}
+
+void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-L DIRECTORY] [-o OUTPUT [-n FRAMES] [-s nearest|scale2x|scale3x] [-f FACTOR] [-l] [-u] ROM]\n", program);
+    fprintf(stderr, "  -L  hash the ROMs under DIRECTORY into %s and list them\n", LIBRARY_INDEX);
+    fprintf(stderr, "  -o  run without a window and export frames to OUTPUT (.y4m, .png sequence, anything else raw RGBA)\n");
+    fprintf(stderr, "  -n  number of frames to run, default %d\n", EXPORT_FRAMES);
+    fprintf(stderr, "  -s  upscaling filter, default nearest\n");
+    fprintf(stderr, "  -f  output pixels per CHIP-8 pixel, default %d\n", EXPORT_FACTOR);
+    fprintf(stderr, "  -l  darken the last row of every pixel (scanlines)\n");
+    fprintf(stderr, "  -u  drop unchanged frames instead of repeating them\n");
+}
+
+// Instructions per frame for a ROM, from the database entry matching its hash
+int rom_ipf(Chip8Library *library, const char *rom_path) {
+    const Chip8RomInfo *rom = Chip8LibraryFind(library, rom_path);
+    if (library->hashed > 0) {
+        Chip8LibrarySaveIndex(library, LIBRARY_INDEX);
+        library->hashed = 0;
+    }
+
+    const Chip8RomSettings *settings = rom ? Chip8LibraryLookup(library, rom->sha1) : NULL;
+    if (!settings) return IPF;
+
+    TraceLog(LOG_INFO, "ROM: %s (%s, %d instructions per second)", settings->name, settings->platform, settings->ips);
+    if (!Chip8SettingsMatchBuild(settings)) {
+        TraceLog(LOG_WARNING, "ROM: %s expects a different platform or quirks than this build, it may not run correctly", settings->name);
+    }
+    return settings->ips >= FPS ? settings->ips / FPS : IPF;
+}
+
+int scan_library(Chip8Library *library, const char *directory) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (!Chip8LibraryScan(library, directory, threads > 0 ? (int)threads : 1)) {
+        fprintf(stderr, "Could not scan %s\n", directory);
+        return 1;
+    }
+    if (!Chip8LibrarySaveIndex(library, LIBRARY_INDEX)) {
+        fprintf(stderr, "Could not write %s\n", LIBRARY_INDEX);
+        return 1;
+    }
+
+    for (size_t i = 0; i < library->rom_count; ++i) {
+        char hex[CHIP8_SHA1_SIZE * 2 + 1];
+        Chip8FormatHash(library->roms[i].sha1, hex);
+        const Chip8RomSettings *settings = Chip8LibraryLookup(library, library->roms[i].sha1);
+        printf("%s %-8s %5d %s\n", hex, settings ? settings->platform : "?", settings ? settings->ips : 0, library->roms[i].path);
+    }
+    printf("%zu ROMs, %zu hashed\n", library->rom_count, library->hashed);
+    return 0;
+}
+
+// Run the ROM for a fixed number of frames without a window, exporting every frame
+int run_headless(const char *rom_path, const char *output, int frames, int ipf, Chip8Filter filter, int factor, bool scanlines, bool skip_unchanged) {
+    Chip8State state = Chip8Init();
+    Chip8LoadFont(&state, NULL, 0);
+
+    unsigned int byte_read = 0;
+    unsigned char *data = LoadFileData(rom_path, &byte_read);
+    if (!data || !Chip8LoadProgram(&state, data, byte_read)) {
+        fprintf(stderr, "Could not load ROM %s\n", rom_path);
+        UnloadFileData(data);
+        return 1;
+    }
+    UnloadFileData(data);
+    state.halt = false;
+
+    Chip8ExportFormat format = CHIP8_EXPORT_RAW;
+    if (IsFileExtension(output, ".y4m")) format = CHIP8_EXPORT_Y4M;
+    if (IsFileExtension(output, ".png")) format = CHIP8_EXPORT_PNG;
+
+    Chip8Upscaler upscaler;
+    if (!Chip8UpscalerInit(&upscaler, CHIP8_SCREEN_WIDTH, CHIP8_SCREEN_HEIGHT, filter, factor, scanlines, RAYWHITE, BLACK)) {
+        fprintf(stderr, "Invalid scale factor %d for the selected filter\n", factor);
+        return 1;
+    }
+
+    Chip8FrameExporter exporter;
+    if (!Chip8ExporterOpen(&exporter, &upscaler, output, format, FPS, skip_unchanged)) {
+        fprintf(stderr, "Could not open %s\n", output);
+        Chip8UpscalerFree(&upscaler);
+        return 1;
+    }
+
+    int result = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        for (int i = 0; i < ipf; ++i) {
+            Chip8MakeCycle(&state);
+        }
+        tick_timers(&state);
+
+        if (!Chip8ExporterWrite(&exporter, &state.screen[0][0])) {
+            fprintf(stderr, "Could not write frame %d to %s\n", frame, output);
+            result = 1;
+            break;
+        }
+    }
+
+    printf("%zu of %zu frames written to %s\n", exporter.written, exporter.frame, output);
+    Chip8ExporterClose(&exporter);
+    Chip8UpscalerFree(&upscaler);
+    return result;
+}
+
 static const char font_path[] = "./assets/fonts/slkscr.ttf";
 
-int main(void) {
+int main(int argc, char **argv) {
+    const char *output = NULL;
+    const char *library_directory = NULL;
+    int frames = EXPORT_FRAMES;
+    Chip8Filter filter = CHIP8_FILTER_NEAREST;
+    int factor = EXPORT_FACTOR;
+    bool scanlines = false;
+    bool skip_unchanged = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "L:o:n:s:f:luh")) != -1) {
+        switch (option) {
+            case 'L': library_directory = optarg; break;
+            case 'o': output = optarg; break;
+            case 'n':
+            case 'f': {
+                    if (!parse_count(optarg, option == 'n' ? &frames : &factor)) {
+                        usage(argv[0]);
+                        return 1;
+                    }
+                } break;
+            case 'l': scanlines = true; break;
+            case 'u': skip_unchanged = true; break;
+            case 's': {
+                    if (strcmp(optarg, "nearest") == 0) filter = CHIP8_FILTER_NEAREST;
+                    else if (strcmp(optarg, "scale2x") == 0) filter = CHIP8_FILTER_SCALE2X;
+                    else if (strcmp(optarg, "scale3x") == 0) filter = CHIP8_FILTER_SCALE3X;
+                    else {
+                        usage(argv[0]);
+                        return 1;
+                    }
+                } break;
+            default:
+                usage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    Chip8Library library = Chip8LibraryInit();
+    Chip8LibraryLoadDatabase(&library, ROM_DATABASE);
+    Chip8LibraryLoadIndex(&library, LIBRARY_INDEX);
+
+    if (library_directory) {
+        int result = scan_library(&library, library_directory);
+        Chip8LibraryFree(&library);
+        return result;
+    }
+
+    if (output) {
+        if (optind >= argc) {
+            usage(argv[0]);
+            Chip8LibraryFree(&library);
+            return 1;
+        }
+        SetTraceLogLevel(LOG_WARNING);
+        int ipf = rom_ipf(&library, argv[optind]);
+        Chip8LibraryFree(&library);
+        return run_headless(argv[optind], output, frames, ipf, filter, factor, scanlines, skip_unchanged);
+    }
+
 #ifdef DEBUG
     SetTraceLogLevel(LOG_ALL);
 #else
@@ -74,6 +274,13 @@ int main(void) {
     Chip8State state = Chip8Init();
     Chip8LoadFont(&state, NULL, 0);
 
+    Chip8Debugger debugger = Chip8DebuggerInit();
+#ifdef DEBUG
+    if (!Chip8DebuggerListen(&debugger, DEBUGGER_SOCKET)) {
+        TraceLog(LOG_WARNING, "Could not open debugger socket %s", DEBUGGER_SOCKET);
+    }
+#endif
+
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Chip-8 Emulator");
 
     SetTargetFPS(FPS);
@@ -92,6 +299,7 @@ int main(void) {
     text_pos.y = SCREEN_HEIGHT/2.0f - text_dim.y/2.0f;
 
     int instructions = 0;
+    int ipf = IPF;
 
     while (!WindowShouldClose()) {
         if (IsFileDropped()) {
@@ -103,6 +311,7 @@ int main(void) {
                 unsigned char *data = LoadFileData(list.paths[0], &byte_read);
                 Chip8LoadProgram(&state, data, byte_read);
                 UnloadFileData(data);
+                ipf = rom_ipf(&library, list.paths[0]);
             } else {
                 message = error_message;
                 message_color = RED;
@@ -116,21 +325,28 @@ int main(void) {
 
         BeginDrawing();
             handle_input(&state);
-            while (!state.halt && instructions < IPF) {
-                PollInputEvents();
-                Chip8MakeCycle(&state);
-                //StateStatus(&state);
-                instructions++;
+            Chip8DebuggerPoll(&debugger, &state);
+            // Breakpoints are only checked by Chip8DebugCycle, so without any set the loop runs at full speed
+            if (Chip8DebuggerArmed(&debugger)) {
+                while (!state.halt && !debugger.stopped && instructions < ipf) {
+                    PollInputEvents();
+                    if (Chip8DebugCycle(&debugger, &state) == CHIP8_BREAK) break;
+                    instructions++;
+                }
+            } else {
+                while (!state.halt && !debugger.stopped && instructions < ipf) {
+                    PollInputEvents();
+                    Chip8MakeCycle(&state);
+                    //StateStatus(&state);
+                    instructions++;
+                }
             }
 
-            if (state.delay_timer > 0) {
-                state.delay_timer--;
-            }
-            if (state.sound_timer > 0) {
-                state.sound_timer--;
+            if (!debugger.stopped) {
+                tick_timers(&state);
             }
 
-            if (instructions >= IPF) {
+            if (instructions >= ipf) {
                 instructions = 0;
             }
 
@@ -143,6 +359,10 @@ int main(void) {
         EndDrawing();
     }
 
+#ifdef DEBUG
+    Chip8DebuggerClose(&debugger, DEBUGGER_SOCKET);
+#endif
+    Chip8LibraryFree(&library);
     UnloadFont(font);
     CloseWindow();
 